@@ -0,0 +1,404 @@
+#include "access_profiler.h"
+#include <cstdio>
+#include <chrono>
+
+static const char *segment_names[NUM_OF_SEGMENTS] = {"text", "data", "bss", "heap_stack"};
+
+// Ids are never reused, so the cache below never matches a destroyed profiler
+static std::atomic<int> next_profiler_id(1);
+
+// Last ring used by the current thread and the id of the profiler that owns it
+static thread_local int cached_ring_owner = 0;
+static thread_local profile_ring *cached_ring = NULL;
+
+/**
+ * Constructor to initialize the profiler and start the aggregator thread.
+ *
+ * @param sample_rate       Record one in sample_rate touches (or pages).
+ * @param bucket_length     Number of time units in each heatmap bucket.
+ * @param mode              How touches are sampled.
+ * @param flush_interval_ms How often the aggregator drains the rings.
+ */
+access_profiler::access_profiler(int sample_rate, int bucket_length, sample_mode mode, int flush_interval_ms)
+{
+    this->id = next_profiler_id++;
+    this->sample_rate = sample_rate < 1 ? 1 : sample_rate;
+    this->sample_threshold = 0xFFFFFFFFu / this->sample_rate;
+    this->bucket_length = bucket_length < 1 ? 1 : bucket_length;
+    this->flush_interval_ms = flush_interval_ms < 1 ? 1 : flush_interval_ms;
+    this->mode = mode;
+    for (int i = 0; i < NUM_OF_SEGMENTS; i++)
+    {
+        segment_pages[i] = 0;
+    }
+    this->running = true;
+    aggregator = std::thread(&access_profiler::aggregate, this);
+}
+
+/**
+ * Destructor to stop the aggregator thread and free the rings.
+ */
+access_profiler::~access_profiler()
+{
+    {
+        std::lock_guard<std::mutex> lock(aggregate_lock);
+        running = false;
+    }
+    wakeup.notify_one();
+    aggregator.join();
+    for (std::map<std::thread::id, profile_ring *>::iterator it = rings.begin(); it != rings.end(); ++it)
+    {
+        delete it->second;
+    }
+}
+
+/**
+ * Function to record a touch that passed hash sampling, or any touch when
+ * sampling one in every N touches.
+ *
+ * @param segment   The type of the page.
+ * @param page      The number of the page.
+ * @param time      The time of the touch.
+ */
+void access_profiler::recordSampledAccess(int segment, int page, int time)
+{
+    profile_ring *ring = threadRing();
+    if (mode == SAMPLE_EVERY_NTH)
+    {
+        if (--ring->countdown > 0)
+            return;
+        ring->countdown = sample_rate;
+    }
+    push(ring, EVENT_ACCESS, segment, page, time);
+}
+
+/**
+ * Function to record a page fault. Faults are rare next to touches so
+ * every one of them is recorded.
+ *
+ * @param segment   The type of the page.
+ * @param page      The number of the page.
+ * @param time      The time of the fault.
+ */
+void access_profiler::record_fault(int segment, int page, int time)
+{
+    push(threadRing(), EVENT_FAULT, segment, page, time);
+}
+
+/**
+ * Function to record the eviction of a page from memory to swap, or the drop
+ * of a clean page.
+ *
+ * @param segment   The type of the page.
+ * @param page      The number of the page.
+ * @param time      The time of the eviction.
+ */
+void access_profiler::record_evict(int segment, int page, int time)
+{
+    push(threadRing(), EVENT_EVICT, segment, page, time);
+}
+
+/**
+ * Function to record a page moving from the main memory to the slow tier.
+ *
+ * @param segment   The type of the page.
+ * @param page      The number of the page.
+ * @param time      The time of the demotion.
+ */
+void access_profiler::record_demote(int segment, int page, int time)
+{
+    push(threadRing(), EVENT_DEMOTE, segment, page, time);
+}
+
+/**
+ * Function to record a page moving from the slow tier to the main memory.
+ *
+ * @param segment   The type of the page.
+ * @param page      The number of the page.
+ * @param time      The time of the promotion.
+ */
+void access_profiler::record_promote(int segment, int page, int time)
+{
+    push(threadRing(), EVENT_PROMOTE, segment, page, time);
+}
+
+/**
+ * Function to set the number of pages of a segment, used to bound the
+ * working set size estimates.
+ *
+ * @param segment   The type of the pages.
+ * @param pages     The number of pages of the segment.
+ */
+void access_profiler::set_segment_pages(int segment, int pages)
+{
+    if (segment < 0 || segment >= NUM_OF_SEGMENTS)
+        return;
+    std::lock_guard<std::mutex> lock(aggregate_lock);
+    segment_pages[segment] = pages;
+}
+
+/**
+ * Function to aggregate every event recorded so far.
+ */
+void access_profiler::flush()
+{
+    std::lock_guard<std::mutex> lock(aggregate_lock);
+    drainRings();
+}
+
+/**
+ * Function to find the ring of the calling thread, creating it on first use.
+ * The rings are owned by the profiler, so only the last one used is cached
+ * per thread and the lock is only taken when that cache misses.
+ *
+ * @return  The ring of the calling thread.
+ */
+profile_ring *access_profiler::threadRing()
+{
+    if (cached_ring_owner == id)
+        return cached_ring;
+    std::lock_guard<std::mutex> lock(aggregate_lock);
+    profile_ring *&ring = rings[std::this_thread::get_id()];
+    if (ring == NULL)
+    {
+        ring = new profile_ring;
+        ring->head = 0;
+        ring->tail = 0;
+        ring->dropped = 0;
+        ring->countdown = sample_rate;
+    }
+    cached_ring_owner = id;
+    cached_ring = ring;
+    return ring;
+}
+
+/**
+ * Function to add an event to the ring of the calling thread without locking.
+ * The event is dropped if the aggregator has fallen behind.
+ *
+ * @param ring      The ring of the calling thread.
+ * @param type      The type of the event.
+ * @param segment   The type of the page.
+ * @param page      The number of the page.
+ * @param time      The time of the event.
+ */
+void access_profiler::push(profile_ring *ring, int type, int segment, int page, int time)
+{
+    unsigned head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) == PROFILER_RING_SIZE)
+    {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    profile_event &event = ring->events[head & (PROFILER_RING_SIZE - 1)];
+    event.type = type;
+    event.segment = segment;
+    event.page = page;
+    event.time = time;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * Function run by the aggregator thread, drains the rings every flush interval.
+ */
+void access_profiler::aggregate()
+{
+    std::unique_lock<std::mutex> lock(aggregate_lock);
+    while (running)
+    {
+        drainRings();
+        wakeup.wait_for(lock, std::chrono::milliseconds(flush_interval_ms));
+    }
+    drainRings();
+}
+
+/**
+ * Function to move all the events from the rings into the heatmap.
+ * Must be called with aggregate_lock held.
+ */
+void access_profiler::drainRings()
+{
+    for (std::map<std::thread::id, profile_ring *>::iterator it = rings.begin(); it != rings.end(); ++it)
+    {
+        profile_ring *ring = it->second;
+        unsigned tail = ring->tail.load(std::memory_order_relaxed);
+        unsigned head = ring->head.load(std::memory_order_acquire);
+        while (tail != head)
+        {
+            addEvent(ring->events[tail & (PROFILER_RING_SIZE - 1)]);
+            tail++;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+}
+
+/**
+ * Function to add one event to its time bucket.
+ *
+ * @param event     The event to add.
+ */
+void access_profiler::addEvent(const profile_event &event)
+{
+    if (event.segment < 0 || event.segment >= NUM_OF_SEGMENTS || event.page < 0 || event.time < 0)
+        return;
+    size_t b = event.time / bucket_length;
+    while (buckets.size() <= b)
+    {
+        heat_bucket bucket;
+        for (int i = 0; i < NUM_OF_SEGMENTS; i++)
+        {
+            bucket.faults[i] = 0;
+            bucket.evictions[i] = 0;
+            bucket.demotions[i] = 0;
+            bucket.promotions[i] = 0;
+        }
+        buckets.push_back(bucket);
+    }
+    heat_bucket &bucket = buckets[b];
+    if (event.type == EVENT_FAULT)
+    {
+        bucket.faults[event.segment]++;
+    }
+    else if (event.type == EVENT_EVICT)
+    {
+        bucket.evictions[event.segment]++;
+    }
+    else if (event.type == EVENT_DEMOTE)
+    {
+        bucket.demotions[event.segment]++;
+    }
+    else if (event.type == EVENT_PROMOTE)
+    {
+        bucket.promotions[event.segment]++;
+    }
+    else
+    {
+        std::vector<int> &touches = bucket.touches[event.segment];
+        if ((int)touches.size() <= event.page)
+            touches.resize(event.page + 1, 0);
+        touches[event.page]++;
+    }
+}
+
+/**
+ * Function to estimate how many pages of a segment were used in a bucket.
+ * With hash sampling every touch of a sampled page is seen, so the number of
+ * sampled pages is scaled up by the sample rate. With 1-in-N sampling the
+ * number of pages seen is a lower bound. The estimate never exceeds the
+ * number of pages of the segment, when it is known.
+ *
+ * @param bucket    The bucket to estimate.
+ * @param segment   The type of the pages.
+ * @return          The estimated working set size in pages.
+ */
+int access_profiler::workingSetSize(const heat_bucket &bucket, int segment)
+{
+    int pages = 0;
+    for (size_t i = 0; i < bucket.touches[segment].size(); i++)
+    {
+        if (bucket.touches[segment][i] > 0)
+            pages++;
+    }
+    if (mode == SAMPLE_PAGE_HASH)
+        pages *= sample_rate;
+    if (segment_pages[segment] > 0 && pages > segment_pages[segment])
+        pages = segment_pages[segment];
+    return pages;
+}
+
+/**
+ * Function to count the events lost on full rings.
+ * Must be called with aggregate_lock held.
+ *
+ * @return  The number of dropped events.
+ */
+unsigned long access_profiler::droppedEvents()
+{
+    unsigned long dropped = 0;
+    for (std::map<std::thread::id, profile_ring *>::iterator it = rings.begin(); it != rings.end(); ++it)
+    {
+        dropped += it->second->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+/**
+ * Function to write the heatmap to a CSV file, one row per value:
+ * kind,bucket,segment,page,value where kind is touches, faults, evictions,
+ * demotions, promotions or wss. The page column is only set for touches.
+ *
+ * @param file_name     The name of the CSV file.
+ * @return              True if the file was written, false otherwise.
+ */
+bool access_profiler::export_csv(const char *file_name)
+{
+    FILE *out = fopen(file_name, "w");
+    if (out == NULL)
+    {
+        perror("ERR");
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(aggregate_lock);
+    drainRings();
+    fprintf(out, "kind,bucket,segment,page,value\n");
+    for (size_t b = 0; b < buckets.size(); b++)
+    {
+        for (int s = 0; s < NUM_OF_SEGMENTS; s++)
+        {
+            const heat_bucket &bucket = buckets[b];
+            for (size_t p = 0; p < bucket.touches[s].size(); p++)
+            {
+                if (bucket.touches[s][p] > 0)
+                    fprintf(out, "touches,%zu,%s,%zu,%d\n", b, segment_names[s], p, bucket.touches[s][p]);
+            }
+            fprintf(out, "faults,%zu,%s,,%d\n", b, segment_names[s], bucket.faults[s]);
+            fprintf(out, "evictions,%zu,%s,,%d\n", b, segment_names[s], bucket.evictions[s]);
+            fprintf(out, "demotions,%zu,%s,,%d\n", b, segment_names[s], bucket.demotions[s]);
+            fprintf(out, "promotions,%zu,%s,,%d\n", b, segment_names[s], bucket.promotions[s]);
+            fprintf(out, "wss,%zu,%s,,%d\n", b, segment_names[s], workingSetSize(bucket, s));
+        }
+    }
+    return fclose(out) == 0;
+}
+
+/**
+ * Function to write the heatmap and the sampling settings to a JSON file.
+ *
+ * @param file_name     The name of the JSON file.
+ * @return              True if the file was written, false otherwise.
+ */
+bool access_profiler::export_json(const char *file_name)
+{
+    FILE *out = fopen(file_name, "w");
+    if (out == NULL)
+    {
+        perror("ERR");
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(aggregate_lock);
+    drainRings();
+    fprintf(out, "{\n  \"sample_rate\": %d,\n  \"sample_mode\": \"%s\",\n  \"bucket_length\": %d,\n",
+            sample_rate, mode == SAMPLE_PAGE_HASH ? "page_hash" : "every_nth", bucket_length);
+    fprintf(out, "  \"dropped_events\": %lu,\n  \"buckets\": [", droppedEvents());
+    for (size_t b = 0; b < buckets.size(); b++)
+    {
+        const heat_bucket &bucket = buckets[b];
+        fprintf(out, "%s\n    {\"bucket\": %zu, \"start_time\": %zu, \"segments\": {",
+                b == 0 ? "" : ",", b, b * bucket_length);
+        for (int s = 0; s < NUM_OF_SEGMENTS; s++)
+        {
+            fprintf(out, "%s\n      \"%s\": {\"faults\": %d, \"evictions\": %d, \"demotions\": %d, "
+                         "\"promotions\": %d, \"wss\": %d, \"touches\": [",
+                    s == 0 ? "" : ",", segment_names[s], bucket.faults[s], bucket.evictions[s],
+                    bucket.demotions[s], bucket.promotions[s], workingSetSize(bucket, s));
+            for (size_t p = 0; p < bucket.touches[s].size(); p++)
+            {
+                fprintf(out, "%s%d", p == 0 ? "" : ", ", bucket.touches[s][p]);
+            }
+            fprintf(out, "]}");
+        }
+        fprintf(out, "\n    }}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+    return fclose(out) == 0;
+}
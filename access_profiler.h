@@ -0,0 +1,144 @@
+#ifndef EX4_ACCESS_PROFILER_H
+#define EX4_ACCESS_PROFILER_H
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#define PROFILER_RING_SIZE 4096 // events per ring, must be a power of two
+#define NUM_OF_SEGMENTS 4
+
+enum profile_event_type
+{
+    EVENT_ACCESS,
+    EVENT_FAULT,
+    EVENT_EVICT,
+    EVENT_DEMOTE,
+    EVENT_PROMOTE
+};
+
+enum sample_mode
+{
+    SAMPLE_EVERY_NTH, // record one in every N page touches
+    SAMPLE_PAGE_HASH  // record every touch of one in N pages, chosen by hash
+};
+
+typedef struct profile_event
+{
+    int type;
+    int segment;
+    int page;
+    int time;
+} profile_event;
+
+// Single producer / single consumer ring, one per recording thread
+typedef struct profile_ring
+{
+    profile_event events[PROFILER_RING_SIZE];
+    std::atomic<unsigned> head;           // next slot to write, owned by the recording thread
+    std::atomic<unsigned> tail;           // next slot to read, owned by the aggregator
+    std::atomic<unsigned long> dropped;   // events lost because the ring was full
+    unsigned countdown;                   // touches left until the next sample
+} profile_ring;
+
+// Aggregated counts of one time bucket
+typedef struct heat_bucket
+{
+    std::vector<int> touches[NUM_OF_SEGMENTS]; // sampled touches per page
+    int faults[NUM_OF_SEGMENTS];
+    int evictions[NUM_OF_SEGMENTS];
+    int demotions[NUM_OF_SEGMENTS];
+    int promotions[NUM_OF_SEGMENTS];
+} heat_bucket;
+
+class access_profiler
+{
+    int id;                            // unique id, used to find this profiler's ring per thread
+    int sample_rate;                   // N of the 1-in-N sampling
+    unsigned sample_threshold;         // hashes at or below this are sampled, about 1 in N
+    int bucket_length;                 // number of time units in each heatmap bucket
+    int flush_interval_ms;             // how often the aggregator drains the rings
+    sample_mode mode;                  // how touches are sampled
+    int segment_pages[NUM_OF_SEGMENTS]; // number of pages of each segment, 0 when unknown
+    std::map<std::thread::id, profile_ring *> rings; // ring of each recording thread
+    std::vector<heat_bucket> buckets;  // heatmap, indexed by time / bucket_length
+    std::mutex aggregate_lock;         // guards rings, buckets and the consumer side of the rings
+    std::condition_variable wakeup;
+    bool running;
+    std::thread aggregator;
+
+private:
+    profile_ring *threadRing();
+
+    void push(profile_ring *ring, int type, int segment, int page, int time);
+
+    bool pageSampled(int segment, int page) const;
+
+    void recordSampledAccess(int segment, int page, int time);
+
+    void aggregate();
+
+    void drainRings();
+
+    void addEvent(const profile_event &event);
+
+    int workingSetSize(const heat_bucket &bucket, int segment);
+
+    unsigned long droppedEvents();
+
+public:
+    access_profiler(int sample_rate, int bucket_length,
+                    sample_mode mode = SAMPLE_EVERY_NTH, int flush_interval_ms = 1);
+
+    ~access_profiler();
+
+    void record_access(int segment, int page, int time);
+
+    void record_fault(int segment, int page, int time);
+
+    void record_evict(int segment, int page, int time);
+
+    void record_demote(int segment, int page, int time);
+
+    void record_promote(int segment, int page, int time);
+
+    void set_segment_pages(int segment, int pages);
+
+    void flush();
+
+    bool export_csv(const char *file_name);
+
+    bool export_json(const char *file_name);
+};
+
+/**
+ * Function to decide if a page is picked by hash sampling. The hash is
+ * multiplicative, so the same pages are always picked.
+ *
+ * @param segment   The type of the page.
+ * @param page      The number of the page.
+ * @return          True if the page is sampled, false otherwise.
+ */
+inline bool access_profiler::pageSampled(int segment, int page) const
+{
+    unsigned h = ((unsigned)segment << 24 ^ (unsigned)page) * 2654435761u;
+    return h <= sample_threshold;
+}
+
+/**
+ * Function to record a touch of a page, subject to sampling. Inlined so that
+ * touches rejected by hash sampling cost only the hash.
+ *
+ * @param segment   The type of the page.
+ * @param page      The number of the page.
+ * @param time      The time of the touch.
+ */
+inline void access_profiler::record_access(int segment, int page, int time)
+{
+    if (mode == SAMPLE_PAGE_HASH && !pageSampled(segment, page))
+        return;
+    recordSampledAccess(segment, page, time);
+}
+
+#endif // EX4_ACCESS_PROFILER_H
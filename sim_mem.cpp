@@ -1,16 +1,19 @@
 #include "sim_mem.h"
+#include "access_profiler.h"
 #include <iostream>
 #include <csignal>
 #include <fcntl.h>
 #include <cstring>
-#include <cmath>
+#include <cerrno>
+#include <unistd.h>
 #include <sys/stat.h>
 
 // Global variable to count the last time the page was used
 int timeT = 0;
 
 /**
- * Constructor to initialize all class parameters.
+ * Constructor to initialize all class parameters, with the same page size
+ * for all segments.
  *
  * @param exe_file_name     The name of the executable file.
  * @param swap_file_name    The name of the swap file.
@@ -22,6 +25,51 @@ int timeT = 0;
  */
 sim_mem::sim_mem(char exe_file_name[], char swap_file_name[], int text_size, int data_size, int bss_size, int heap_stack_size, int page_size)
 {
+    int page_sizes[4] = {page_size, page_size, page_size, page_size};
+    init(exe_file_name, swap_file_name, text_size, data_size, bss_size, heap_stack_size, page_sizes);
+}
+
+/**
+ * Constructor to initialize all class parameters, with a page size per segment.
+ * Every page size must be a power of 2 that fits both in the main memory and
+ * in the 1024 bytes of a segment.
+ *
+ * @param exe_file_name     The name of the executable file.
+ * @param swap_file_name    The name of the swap file.
+ * @param text_size         Size of the text segment.
+ * @param data_size         Size of the data segment.
+ * @param bss_size          Size of the BSS segment.
+ * @param heap_stack_size   Size of the heap and stack segments.
+ * @param page_sizes        Page size of the text, data, bss and heap-stack segments.
+ */
+sim_mem::sim_mem(char exe_file_name[], char swap_file_name[], int text_size, int data_size, int bss_size, int heap_stack_size, int page_sizes[])
+{
+    init(exe_file_name, swap_file_name, text_size, data_size, bss_size, heap_stack_size, page_sizes);
+}
+
+/**
+ * Function to initialize all class parameters, shared by the constructors.
+ *
+ * @param exe_file_name     The name of the executable file.
+ * @param swap_file_name    The name of the swap file.
+ * @param text_size         Size of the text segment.
+ * @param data_size         Size of the data segment.
+ * @param bss_size          Size of the BSS segment.
+ * @param heap_stack_size   Size of the heap and stack segments.
+ * @param page_sizes        Page size of the text, data, bss and heap-stack segments.
+ */
+void sim_mem::init(char exe_file_name[], char swap_file_name[], int text_size, int data_size, int bss_size, int heap_stack_size, int page_sizes[])
+{
+    // Check the page sizes before touching any file
+    for (int i = 0; i < 4; i++)
+    {
+        int size = page_sizes[i];
+        if (size <= 0 || (size & (size - 1)) != 0 || size > 1024 || size > MEMORY_SIZE)
+        {
+            printf("ERR\n");
+            exit(1);
+        }
+    }
     // Initialize all the main memory to '0'
     memset(main_memory, '0', MEMORY_SIZE);
     // Open the exe file
@@ -42,13 +90,42 @@ sim_mem::sim_mem(char exe_file_name[], char swap_file_name[], int text_size, int
     this->data_size = data_size;
     this->bss_size = bss_size;
     this->heap_stack_size = heap_stack_size;
-    this->page_size = page_size;
+    this->page_size = page_sizes[0];
+    for (int i = 1; i < 4; i++)
+    {
+        if (page_sizes[i] < this->page_size)
+            this->page_size = page_sizes[i];
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        segment_page_size[i] = page_sizes[i];
+        frames_per_page[i] = page_sizes[i] / this->page_size;
+    }
     this->num_of_pages = MEMORY_SIZE / page_size;
+    this->profiler = NULL;
 
-    num_of_txt_pages = this->text_size / page_size;
-    num_of_data_pages = this->data_size / page_size;
-    num_of_bss_pages = this->bss_size / page_size;
-    num_of_stack_heap_pages = this->heap_stack_size / page_size;
+    // No slow tier until set_slow_tier is called
+    slow_memory = NULL;
+    slow_frames = NULL;
+    num_of_slow_pages = 0;
+    fast_latency = 0;
+    slow_latency = 0;
+    swap_latency = 0;
+    promote_threshold = 0;
+    promote_interval = 1;
+    accesses_since_scan = 0;
+    fast_hits = 0;
+    slow_hits = 0;
+    misses = 0;
+    promotions = 0;
+    demotions = 0;
+    access_time = 0;
+
+    // Round up, so a segment smaller than its page size still has a page
+    num_of_txt_pages = (this->text_size + segment_page_size[0] - 1) / segment_page_size[0];
+    num_of_data_pages = (this->data_size + segment_page_size[1] - 1) / segment_page_size[1];
+    num_of_bss_pages = (this->bss_size + segment_page_size[2] - 1) / segment_page_size[2];
+    num_of_stack_heap_pages = (this->heap_stack_size + segment_page_size[3] - 1) / segment_page_size[3];
 
     frames = new bool[this->num_of_pages];
     for (int i = 0; i < num_of_pages; i++)
@@ -70,6 +147,8 @@ sim_mem::sim_mem(char exe_file_name[], char swap_file_name[], int text_size, int
         page_table[0][i].valid = false;
         page_table[0][i].dirty = false;
         page_table[0][i].time = INT32_MAX;
+        page_table[0][i].tier = 0;
+        page_table[0][i].accesses = 0;
     }
 
     for (int i = 0; i < num_of_data_pages; ++i)
@@ -79,6 +158,8 @@ sim_mem::sim_mem(char exe_file_name[], char swap_file_name[], int text_size, int
         page_table[1][i].valid = false;
         page_table[1][i].dirty = false;
         page_table[1][i].time = INT32_MAX;
+        page_table[1][i].tier = 0;
+        page_table[1][i].accesses = 0;
     }
 
     for (int i = 0; i < num_of_bss_pages; ++i)
@@ -88,6 +169,8 @@ sim_mem::sim_mem(char exe_file_name[], char swap_file_name[], int text_size, int
         page_table[2][i].valid = false;
         page_table[2][i].dirty = false;
         page_table[2][i].time = INT32_MAX;
+        page_table[2][i].tier = 0;
+        page_table[2][i].accesses = 0;
     }
 
     for (int i = 0; i < num_of_stack_heap_pages; ++i)
@@ -97,14 +180,32 @@ sim_mem::sim_mem(char exe_file_name[], char swap_file_name[], int text_size, int
         page_table[3][i].valid = false;
         page_table[3][i].dirty = false;
         page_table[3][i].time = INT32_MAX;
+        page_table[3][i].tier = 0;
+        page_table[3][i].accesses = 0;
+    }
+
+    // Only data, bss and heap-stack pages can be swapped out, the swap is
+    // divided into slots of the frame size like the main memory. Each segment
+    // has its own region, so pages of different sizes never fragment each other
+    swap_region[0] = 0;
+    swap_region[1] = 0;
+    swap_region[2] = swap_region[1] + num_of_data_pages * frames_per_page[1];
+    swap_region[3] = swap_region[2] + num_of_bss_pages * frames_per_page[2];
+    num_of_swap_pages = swap_region[3] + num_of_stack_heap_pages * frames_per_page[3];
+    swap_slots = new bool[num_of_swap_pages];
+    for (int i = 0; i < num_of_swap_pages; i++)
+    {
+        swap_slots[i] = false;
     }
 
-    // Initialize the swap file to '0'
-    char str[(page_size * (num_of_bss_pages + num_of_data_pages + num_of_stack_heap_pages))];
-    std::cout << "page:" << sizeof(str) << std::endl;
-    memset(str, '0', sizeof(str));
-    if (write(swapfile_fd, str, sizeof(str)) == -1)
-        perror("1");
+    // Size the swap file as a sparse file: drop any old contents and extend it
+    // without writing, so no disk blocks are used until a page is swapped out
+    if (ftruncate(swapfile_fd, 0) == -1 ||
+        ftruncate(swapfile_fd, (off_t)num_of_swap_pages * page_size) == -1)
+    {
+        perror("ERR");
+        exit(1);
+    }
 }
 
 /**
@@ -115,25 +216,13 @@ sim_mem::sim_mem(char exe_file_name[], char swap_file_name[], int text_size, int
  */
 char sim_mem::load(int address)
 {
-    int ad[12];                   // array to hold the binary address
-    decimalToBinary(address, ad); // convert the address to binary
-    int mType[2];
-    int offsetS = (int)log2(page_size); // calculate how many bits is the offset
-    int offset[offsetS];
-    int pageNumber[10 - offsetS];
-    // copy each part of the address to different array
-    copyAr(ad, mType, 0, 2);
-    copyAr(ad, pageNumber, 2, 12 - offsetS);
-    copyAr(ad, offset, 12 - offsetS, 12);
-    // converting each part of the address back to decimal
-    int memT = binaryToDecimal(mType, 2);
-    if (!legalAddres(address, memT))
+    int memT, pageN, offs;
+    decodeAddress(address, memT, pageN, offs);
+    if (!legalAddres(address, memT) || pageN >= pagesOfType(memT))
     {
         printf("ERR\n");
         return '\0';
     }
-    int pageN = binaryToDecimal(pageNumber, 10 - offsetS);
-    int offs = binaryToDecimal(offset, offsetS);
 
     // if the requested page is already in the main memory return the requested value
     if (page_table[memT][pageN].valid)
@@ -141,23 +230,24 @@ char sim_mem::load(int address)
         int memoryFrame = page_table[memT][pageN].frame;
         timeT++;
         page_table[memT][pageN].time = timeT;
-        return main_memory[memoryFrame * page_size + offs];
+        if (profiler != NULL)
+            profiler->record_access(memT, pageN, timeT);
+        char value = tierMemory(page_table[memT][pageN].tier)[memoryFrame * page_size + offs];
+        tierHit(memT, pageN);
+        return value;
     }
     else
     {
         // if the requested page is not in the main memory
+        if (profiler != NULL && !(memT == 3 && !page_table[memT][pageN].dirty))
+            profiler->record_fault(memT, pageN, timeT + 1);
         if (memT == 0)
         {
             writeToMainMemory(memT, pageN);
         }
         else if (page_table[memT][pageN].dirty)
         {
-            if (findFreeFrame() == -1)
-            {
-                int *ij = oldestPage();
-                writeToSwapFile(ij[0], ij[1], page_table[ij[0]][ij[1]].frame * page_size);
-                delete[] (ij);
-            }
+            makeRoom(memT);
             clearSwapFrame(memT, pageN, page_table[memT][pageN].swap_index);
         }
         else if (memT == 3 && !page_table[memT][pageN].dirty)
@@ -174,7 +264,11 @@ char sim_mem::load(int address)
 
         timeT++;
         page_table[memT][pageN].time = timeT;
-        return main_memory[memoryFrame * page_size + offs];
+        if (profiler != NULL)
+            profiler->record_access(memT, pageN, timeT);
+        char value = main_memory[memoryFrame * page_size + offs];
+        tierMiss();
+        return value;
     }
 }
 
@@ -186,25 +280,13 @@ char sim_mem::load(int address)
  */
 void sim_mem::store(int address, char value)
 {
-    int ad[12];                   // array to hold the binary address
-    decimalToBinary(address, ad); // convert the address to binary
-    int mType[2];
-    int offsetS = (int)log2(page_size); // calculate how many bits is the offset
-    int offset[offsetS];
-    int pageNumber[10 - offsetS];
-    // copy each part of the address to different array
-    copyAr(ad, mType, 0, 2);
-    copyAr(ad, pageNumber, 2, 12 - offsetS);
-    copyAr(ad, offset, 12 - offsetS, 12);
-    // converting each part of the address back to decimal
-    int memT = binaryToDecimal(mType, 2);
-    if (!legalAddres(address, memT))
+    int memT, pageN, offs;
+    decodeAddress(address, memT, pageN, offs);
+    if (!legalAddres(address, memT) || pageN >= pagesOfType(memT))
     {
         printf("ERR\n");
         return;
     }
-    int pageN = binaryToDecimal(pageNumber, 10 - offsetS);
-    int offs = binaryToDecimal(offset, offsetS);
 
     // If the page is in main memory
     if (page_table[memT][pageN].valid)
@@ -215,11 +297,14 @@ void sim_mem::store(int address, char value)
             printf("ERR\n");
             return;
         }
-        // Write the value to main memory
-        main_memory[page_table[memT][pageN].frame * page_size + offs] = value;
+        // Write the value to the memory of the page's tier
+        tierMemory(page_table[memT][pageN].tier)[page_table[memT][pageN].frame * page_size + offs] = value;
         page_table[memT][pageN].dirty = true;
         timeT++;
         page_table[memT][pageN].time = timeT;
+        if (profiler != NULL)
+            profiler->record_access(memT, pageN, timeT);
+        tierHit(memT, pageN);
     }
     else
     {
@@ -231,13 +316,10 @@ void sim_mem::store(int address, char value)
         }
         else
         {
-            // If there is no free frame, find the oldest page and move it to swap
-            if (findFreeFrame() == -1)
-            {
-                int *ij = oldestPage();
-                writeToSwapFile(ij[0], ij[1], page_table[ij[0]][ij[1]].frame * page_size);
-                delete[] ij;
-            }
+            if (profiler != NULL)
+                profiler->record_fault(memT, pageN, timeT + 1);
+            // If there is no free frame, move the oldest pages to swap
+            makeRoom(memT);
             // If the page is dirty, clear the swap frame and load the page back into memory
             if (page_table[memT][pageN].dirty)
             {
@@ -252,7 +334,7 @@ void sim_mem::store(int address, char value)
             int memoryFrame = page_table[memT][pageN].frame;
             if (memT != 1)
             {
-                for (int i = memoryFrame * page_size; i < memoryFrame * page_size + page_size; i++)
+                for (int i = memoryFrame * page_size; i < memoryFrame * page_size + segment_page_size[memT]; i++)
                 {
                     main_memory[i] = '0';
                 }
@@ -261,6 +343,9 @@ void sim_mem::store(int address, char value)
             page_table[memT][pageN].time = timeT;
             page_table[memT][pageN].dirty = true;
             main_memory[memoryFrame * page_size + offs] = value;
+            if (profiler != NULL)
+                profiler->record_access(memT, pageN, timeT);
+            tierMiss();
         }
     }
 }
@@ -276,6 +361,14 @@ void sim_mem::print_memory()
     {
         printf("[%c]\n", main_memory[i]);
     }
+    if (slow_memory != NULL)
+    {
+        printf("\n Slow memory\n");
+        for (i = 0; i < num_of_slow_pages * page_size; i++)
+        {
+            printf("[%c]\n", slow_memory[i]);
+        }
+    }
 }
 
 /**
@@ -286,9 +379,13 @@ void sim_mem::print_swap()
     char *str = (char *)malloc(this->page_size * sizeof(char));
     int i;
     printf("\n Swap memory\n");
-    lseek(swapfile_fd, 0, SEEK_SET); // go to the start of the file
-    while (read(swapfile_fd, str, this->page_size) == this->page_size)
+    for (int slot = 0; slot < num_of_swap_pages; slot++)
     {
+        // Free slots are holes in the file, show them as empty pages
+        if (!swap_slots[slot])
+            memset(str, '0', page_size);
+        else if (pread(swapfile_fd, str, page_size, (off_t)slot * page_size) != page_size)
+            break;
         for (i = 0; i < page_size; i++)
         {
             printf("%d - [%c]\t", i, str[i]);
@@ -305,61 +402,132 @@ void sim_mem::print_page_table()
 {
     int i;
 
-    printf("Valid\t Dirty\t Frame\t Swap index\n");
+    printPageTableHeader();
     for (i = 0; i < num_of_txt_pages; ++i)
     {
-        printf("[%d]\t [%d]\t [%d]\t [%d]\n",
-               page_table[0][i].valid,
-               page_table[0][i].dirty,
-               page_table[0][i].frame,
-               page_table[0][i].swap_index);
+        printPageDescriptor(page_table[0][i]);
     }
 
-    printf("Valid\t Dirty\t Frame\t Swap index\n");
+    printPageTableHeader();
     for (i = 0; i < num_of_data_pages; ++i)
     {
-        printf("[%d]\t [%d]\t [%d]\t [%d]\n",
-               page_table[1][i].valid,
-               page_table[1][i].dirty,
-               page_table[1][i].frame,
-               page_table[1][i].swap_index);
+        printPageDescriptor(page_table[1][i]);
     }
 
-    printf("Valid\t Dirty\t Frame\t Swap index\n");
+    printPageTableHeader();
     for (i = 0; i < num_of_bss_pages; ++i)
     {
-        printf("[%d]\t [%d]\t [%d]\t [%d]\n",
-               page_table[2][i].valid,
-               page_table[2][i].dirty,
-               page_table[2][i].frame,
-               page_table[2][i].swap_index);
+        printPageDescriptor(page_table[2][i]);
     }
 
-    printf("Valid\t Dirty\t Frame\t Swap index\n");
+    printPageTableHeader();
     for (i = 0; i < num_of_stack_heap_pages; ++i)
     {
+        printPageDescriptor(page_table[3][i]);
+    }
+}
+
+/**
+ * Function to print the column names of the page table. The tier column is
+ * only shown when there is a slow tier.
+ */
+void sim_mem::printPageTableHeader()
+{
+    if (slow_memory != NULL)
+        printf("Valid\t Dirty\t Frame\t Swap index\t Tier\n");
+    else
+        printf("Valid\t Dirty\t Frame\t Swap index\n");
+}
+
+/**
+ * Function to print one row of the page table.
+ *
+ * @param page  The page to print.
+ */
+void sim_mem::printPageDescriptor(page_descriptor &page)
+{
+    if (slow_memory != NULL)
+        printf("[%d]\t [%d]\t [%d]\t [%d]\t\t [%d]\n",
+               page.valid, page.dirty, page.frame, page.swap_index, page.tier);
+    else
         printf("[%d]\t [%d]\t [%d]\t [%d]\n",
-               page_table[3][i].valid,
-               page_table[3][i].dirty,
-               page_table[3][i].frame,
-               page_table[3][i].swap_index);
+               page.valid, page.dirty, page.frame, page.swap_index);
+}
+
+/**
+ * Function to add a slower memory tier below the main memory. Pages evicted
+ * from the main memory are demoted to the slow tier, and only pages evicted
+ * from the slow tier go to swap. Every promote_interval accesses, slow tier
+ * pages with at least promote_threshold accesses are promoted back.
+ * Must be called before the first access. A size of 0 keeps a single tier
+ * but still sets the latencies used by print_tier_stats.
+ *
+ * @param slow_memory_size  Size of the slow tier.
+ * @param fast_latency      Cost of an access served by the main memory.
+ * @param slow_latency      Cost of an access served by the slow tier.
+ * @param swap_latency      Extra cost of an access that faults.
+ * @param promote_threshold Slow tier accesses in an interval that make a page hot.
+ * @param promote_interval  Number of accesses between promotion scans.
+ */
+void sim_mem::set_slow_tier(int slow_memory_size, int fast_latency, int slow_latency,
+                            int swap_latency, int promote_threshold, int promote_interval)
+{
+    if (slow_memory != NULL || slow_memory_size < 0 || fast_latency < 0 ||
+        slow_latency < 0 || swap_latency < 0)
+    {
+        printf("ERR\n");
+        return;
     }
+    this->fast_latency = fast_latency;
+    this->slow_latency = slow_latency;
+    this->swap_latency = swap_latency;
+    this->promote_threshold = promote_threshold < 1 ? 1 : promote_threshold;
+    this->promote_interval = promote_interval < 1 ? 1 : promote_interval;
+    num_of_slow_pages = slow_memory_size / page_size;
+    if (num_of_slow_pages == 0)
+        return;
+
+    slow_memory = new char[num_of_slow_pages * page_size];
+    memset(slow_memory, '0', num_of_slow_pages * page_size);
+    slow_frames = new bool[num_of_slow_pages];
+    for (int i = 0; i < num_of_slow_pages; i++)
+    {
+        slow_frames[i] = false;
+    }
+}
+
+/**
+ * Function to print the tier hit rates and the simulated access time.
+ */
+void sim_mem::print_tier_stats()
+{
+    long total = fast_hits + slow_hits + misses;
+    double percent = total == 0 ? 0 : 100.0 / total;
+    printf("\n Tier statistics\n");
+    printf("Accesses:\t\t %ld\n", total);
+    printf("Main memory hits:\t %ld (%.2f%%)\n", fast_hits, fast_hits * percent);
+    printf("Slow tier hits:\t\t %ld (%.2f%%)\n", slow_hits, slow_hits * percent);
+    printf("Page faults:\t\t %ld (%.2f%%)\n", misses, misses * percent);
+    printf("Promotions:\t\t %ld\n", promotions);
+    printf("Demotions:\t\t %ld\n", demotions);
+    printf("Simulated access time:\t %lld (%.2f per access)\n",
+           access_time, total == 0 ? 0 : (double)access_time / total);
 }
 
 /**
- * Function to convert a decimal number to a binary array.
+ * Function to attach an access profiler, or detach it by passing NULL.
+ * The profiler is not owned by the simulator.
  *
- * @param decimal   The decimal number to convert.
- * @param ad        The array to store the binary representation.
+ * @param profiler  The profiler to record to.
  */
-void sim_mem::decimalToBinary(int decimal, int ad[])
+void sim_mem::set_profiler(access_profiler *profiler)
 {
-    int index = 12;
-    while (index > 0)
+    this->profiler = profiler;
+    if (profiler == NULL)
+        return;
+    for (int i = 0; i < 4; i++)
     {
-        ad[index - 1] = decimal % 2;
-        decimal = decimal / 2;
-        index--;
+        profiler->set_segment_pages(i, pagesOfType(i));
     }
 }
 
@@ -371,6 +539,9 @@ sim_mem::~sim_mem()
     close(program_fd);
     close(swapfile_fd);
     delete[] (frames);
+    delete[] (swap_slots);
+    delete[] (slow_memory);
+    delete[] (slow_frames);
     for (int i = 0; i < 4; ++i)
     {
         free(page_table[i]);
@@ -379,58 +550,86 @@ sim_mem::~sim_mem()
 }
 
 /**
- * Function to copy part of an array.
+ * Function to split an address into its memory type, page number and offset,
+ * using the page size of the memory type.
  *
- * @param source    The source array.
- * @param dest      The destination array.
- * @param start     The start index in the source array.
- * @param end       The end index in the source array.
+ * @param address   The address to split.
+ * @param memT      Set to the type of the memory.
+ * @param pageN     Set to the number of the page.
+ * @param offs      Set to the offset in the page.
  */
-void sim_mem::copyAr(int source[], int dest[], int start, int end)
+void sim_mem::decodeAddress(int address, int &memT, int &pageN, int &offs)
 {
-    for (int i = 0; i < end; ++i)
+    // the two high bits of the 12 bit address select the memory type
+    memT = (address >> 10) & 3;
+    pageN = (address & 1023) / segment_page_size[memT];
+    offs = address & (segment_page_size[memT] - 1);
+}
+
+/**
+ * Function to find a run of free slots in a frame or swap map. The run
+ * starts at a multiple of its length, so pages of one size never straddle
+ * the place of a bigger page.
+ *
+ * @param map       The map of used slots.
+ * @param size      The number of slots in the map.
+ * @param count     The number of contiguous slots needed.
+ * @return          The index of the first slot of the run or -1 if no run is found.
+ */
+int sim_mem::findFreeRun(bool *map, int size, int count)
+{
+    for (int i = 0; i + count <= size; i += count)
     {
-        dest[i] = source[start + i];
+        int j = 0;
+        while (j < count && !map[i + j])
+            j++;
+        if (j == count)
+            return i;
     }
+    return -1;
 }
 
 /**
- * Function to convert a binary array to a decimal number.
+ * Function to mark a run of slots in a frame or swap map.
  *
- * @param binary    The binary array to convert.
- * @param size      The size of the binary array.
- * @return          The decimal representation of the binary array.
+ * @param map       The map of used slots.
+ * @param first     The index of the first slot.
+ * @param count     The number of slots.
+ * @param used      True to mark the slots as used, false to free them.
  */
-int sim_mem::binaryToDecimal(int binary[], int size)
+void sim_mem::setRun(bool *map, int first, int count, bool used)
 {
-    int decimal = 0;
-    int base = 1;
-
-    for (int i = size - 1; i >= 0; i--)
+    for (int i = first; i < first + count; i++)
     {
-        if (binary[i] == 1)
-        {
-            decimal += base;
-        }
-        base *= 2;
+        map[i] = used;
     }
+}
 
-    return decimal;
+/**
+ * Function to find free frames in the main memory for a page.
+ *
+ * @param pageType  The type of the page.
+ * @return          The address of the first free frame or -1 if no free frames are found.
+ */
+int sim_mem::findFreeFrame(int pageType)
+{
+    int frame = findFreeRun(frames, num_of_pages, frames_per_page[pageType]);
+    return frame == -1 ? -1 : frame * page_size;
 }
 
 /**
- * Function to find a free frame in the main memory.
+ * Function to free the oldest run of frames in the main memory if a page does
+ * not fit. Its pages go to the slow tier, or to swap when there is no slow tier.
  *
- * @return  The index of the free frame or -1 if no free frame is found.
+ * @param pageType  The type of the page.
  */
-int sim_mem::findFreeFrame()
+void sim_mem::makeRoom(int pageType)
 {
-    for (int i = 0; i < this->num_of_pages; i++)
+    if (findFreeFrame(pageType) == -1)
     {
-        if (!frames[i])
-            return i * page_size;
+        int count = frames_per_page[pageType];
+        evictRun(0, oldestRun(0, count), count);
     }
-    return -1;
 }
 
 /**
@@ -445,57 +644,43 @@ void sim_mem::writeToMainMemory(int pageType, int pageNumber)
     int type = pageType == 0 ? 0 : pageType == 1 ? text_size
                                                  : text_size + data_size;
     std::cout << type << std::endl;
-    int idx = type + (pageNumber * page_size);
-    char temp[page_size];
+    int size = segment_page_size[pageType];
+    int idx = type + (pageNumber * size);
+    char temp[size];
     // reading requested page from exe file
     lseek(program_fd, idx, SEEK_SET);
-    read(program_fd, temp, page_size);
-    if (findFreeFrame() == -1)
-    {
-        int *ij = oldestPage();
-        // move the oldest frame to swap
-        writeToSwapFile(ij[0], ij[1], page_table[ij[0]][ij[1]].frame * page_size);
-        delete[] (ij);
-    }
+    read(program_fd, temp, size);
+    // move the oldest frames to swap
+    makeRoom(pageType);
     // find index of new frame at main memory
-    int frame_index = findFreeFrame();
-    for (int i = frame_index; i < page_size + frame_index; i++)
+    int frame_index = findFreeFrame(pageType);
+    for (int i = frame_index; i < size + frame_index; i++)
     {
         main_memory[i] = temp[i - frame_index];
     }
     page_table[pageType][pageNumber].valid = true;
     page_table[pageType][pageNumber].frame = frame_index / page_size;
-    frames[page_table[pageType][pageNumber].frame] = true;
+    page_table[pageType][pageNumber].tier = 0;
+    page_table[pageType][pageNumber].accesses = 0;
+    setRun(frames, page_table[pageType][pageNumber].frame, frames_per_page[pageType], true);
 }
 
 /**
- * Function to find the next free spot in the swap memory.
+ * Function to find the next free spot in the swap memory for a page.
  *
- * @return  The index of the free swap space or -1 if no free swap space is found.
+ * @param pageType  The type of the page.
+ * @return          The index of the free swap space or -1 if no free swap space is found.
  */
-int sim_mem::getNextFreeSwapFrame()
+int sim_mem::getNextFreeSwapFrame(int pageType)
 {
-    struct stat fileStat;
-    if (fstat(swapfile_fd, &fileStat) == -1)
-    {
-        printf("Failed to get the file status.\n");
-        close(swapfile_fd);
-        return -1;
-    }
-    off_t fileSize = fileStat.st_size;
-    char c[1];
-    for (int i = 0; i < fileSize; i += page_size)
-    {
-        lseek(swapfile_fd, i, SEEK_SET);
-        read(swapfile_fd, c, 1);
-        if (c[0] == '0')
-            return i;
-    }
-    return -1;
+    int region = swap_region[pageType];
+    int end = pageType == 3 ? num_of_swap_pages : swap_region[pageType + 1];
+    int slot = findFreeRun(swap_slots + region, end - region, frames_per_page[pageType]);
+    return slot == -1 ? -1 : (region + slot) * page_size;
 }
 
 /**
- * Function to move a frame from the main memory to the swap.
+ * Function to move a frame from the main memory or the slow tier to the swap.
  *
  * @param pageType      The type of the page.
  * @param pageNumber    The number of the page.
@@ -503,17 +688,22 @@ int sim_mem::getNextFreeSwapFrame()
  */
 void sim_mem::writeToSwapFile(int pageType, int pageNumber, int f)
 {
+    if (profiler != NULL)
+        profiler->record_evict(pageType, pageNumber, timeT);
+    int tier = page_table[pageType][pageNumber].tier;
+    char *memory = tierMemory(tier);
     // Text pages should not be moved to swap
     if (pageType == 0 || !(page_table[pageType][pageNumber].dirty))
     {
-        frames[page_table[pageType][pageNumber].frame] = false;
+        setRun(tierFrames(tier), page_table[pageType][pageNumber].frame, frames_per_page[pageType], false);
+        page_table[pageType][pageNumber].tier = 0;
         page_table[pageType][pageNumber].valid = false;
         page_table[pageType][pageNumber].frame = -1;
         page_table[pageType][pageNumber].time = INT32_MAX;
         return;
     }
 
-    int swap_index = getNextFreeSwapFrame();
+    int swap_index = getNextFreeSwapFrame(pageType);
     if (swap_index == -1)
     {
         printf("Error: No free swap space found.\n");
@@ -522,59 +712,297 @@ void sim_mem::writeToSwapFile(int pageType, int pageNumber, int f)
 
     // Store the swap index in the page table
     page_table[pageType][pageNumber].swap_index = swap_index / page_size;
+    setRun(swap_slots, swap_index / page_size, frames_per_page[pageType], true);
 
     // Create a temporary buffer to hold the page data
-    char temp[page_size];
-    for (int i = 0; i < page_size; ++i)
+    int size = segment_page_size[pageType];
+    char temp[size];
+    for (int i = 0; i < size; ++i)
     {
-        temp[i] = main_memory[f + i];
-        main_memory[f + i] = '0'; // Clear the main memory frame
+        temp[i] = memory[f + i];
+        memory[f + i] = '0'; // Clear the memory frame
     }
 
     // Write the page data to the swap file
     lseek(swapfile_fd, swap_index, SEEK_SET);
-    write(swapfile_fd, temp, page_size);
+    write(swapfile_fd, temp, size);
 
     // Update the frame status and page table
-    frames[page_table[pageType][pageNumber].frame] = false;
+    setRun(tierFrames(tier), page_table[pageType][pageNumber].frame, frames_per_page[pageType], false);
+    page_table[pageType][pageNumber].tier = 0;
     page_table[pageType][pageNumber].valid = false;
     page_table[pageType][pageNumber].frame = -1;
     page_table[pageType][pageNumber].time = INT32_MAX;
 }
 
 /**
- * Function to check which page in the main memory is the oldest.
+ * Function to check if a page in a memory tier uses any frame of a run.
+ *
+ * @param tier          0 for the main memory, 1 for the slow tier.
+ * @param pageType      The type of the page.
+ * @param pageNumber    The number of the page.
+ * @param first         The index of the first frame of the run.
+ * @param count         The number of frames in the run.
+ * @return              True if the page overlaps the run, false otherwise.
+ */
+bool sim_mem::pageInRun(int tier, int pageType, int pageNumber, int first, int count)
+{
+    page_descriptor &page = page_table[pageType][pageNumber];
+    if (!page.valid || page.tier != tier)
+        return false;
+    return page.frame < first + count && page.frame + frames_per_page[pageType] > first;
+}
+
+/**
+ * Function to check which run of frames in a memory tier holds the oldest
+ * pages. A run is as old as the most recently used page in it, so freeing it
+ * evicts only pages that are all older than those of any other run.
  *
- * @return  An array containing the page type and page number of the oldest page.
+ * @param tier  0 for the main memory, 1 for the slow tier.
+ * @param count The number of frames in the run.
+ * @return      The index of the first frame of the oldest run.
  */
-int *sim_mem::oldestPage()
+int sim_mem::oldestRun(int tier, int count)
+{
+    int size = tier == 1 ? num_of_slow_pages : num_of_pages;
+    int best = 0;
+    int bestTime = INT32_MAX;
+    for (int first = 0; first + count <= size; first += count)
+    {
+        int newest = -1;
+        for (int i = 0; i < 4; ++i)
+        {
+            int pages = pagesOfType(i);
+            for (int j = 0; j < pages; ++j)
+            {
+                if (pageInRun(tier, i, j, first, count) && page_table[i][j].time > newest)
+                    newest = page_table[i][j].time;
+            }
+        }
+        if (newest < bestTime)
+        {
+            best = first;
+            bestTime = newest;
+        }
+    }
+    return best;
+}
+
+/**
+ * Function to evict every page that uses a run of frames in a memory tier.
+ * Main memory pages go to the slow tier, or to swap when they cannot.
+ * Slow tier pages go to swap.
+ *
+ * @param tier  0 for the main memory, 1 for the slow tier.
+ * @param first The index of the first frame of the run.
+ * @param count The number of frames in the run.
+ */
+void sim_mem::evictRun(int tier, int first, int count)
 {
-    int t = INT32_MAX;
-    int *idx = new int[2];
-    idx[0] = 0;
-    idx[1] = 0;
-    int size;
     for (int i = 0; i < 4; ++i)
     {
-        if (i == 0)
-            size = num_of_txt_pages;
-        else if (i == 1)
-            size = num_of_data_pages;
-        else if (i == 2)
-            size = num_of_bss_pages;
-        else
-            size = num_of_stack_heap_pages;
+        int pages = pagesOfType(i);
+        for (int j = 0; j < pages; ++j)
+        {
+            if (!pageInRun(tier, i, j, first, count))
+                continue;
+            if (tier == 0 && slow_memory != NULL && frames_per_page[i] <= num_of_slow_pages)
+                demote(i, j);
+            else
+                writeToSwapFile(i, j, page_table[i][j].frame * page_size);
+        }
+    }
+}
+
+/**
+ * Function to get the number of pages of a memory type.
+ *
+ * @param pageType  The type of the page.
+ * @return          The number of pages of that type.
+ */
+int sim_mem::pagesOfType(int pageType)
+{
+    if (pageType == 0)
+        return num_of_txt_pages;
+    else if (pageType == 1)
+        return num_of_data_pages;
+    else if (pageType == 2)
+        return num_of_bss_pages;
+    return num_of_stack_heap_pages;
+}
+
+/**
+ * Function to get the memory of a tier.
+ *
+ * @param tier  0 for the main memory, 1 for the slow tier.
+ * @return      The memory of the tier.
+ */
+char *sim_mem::tierMemory(int tier)
+{
+    return tier == 1 ? slow_memory : main_memory;
+}
+
+/**
+ * Function to get the frame map of a tier.
+ *
+ * @param tier  0 for the main memory, 1 for the slow tier.
+ * @return      The map of used frames of the tier.
+ */
+bool *sim_mem::tierFrames(int tier)
+{
+    return tier == 1 ? slow_frames : frames;
+}
+
+/**
+ * Function to move a page from the main memory to the slow tier. If the slow
+ * tier is full, its oldest run of frames is moved to swap first.
+ *
+ * @param pageType      The type of the page.
+ * @param pageNumber    The number of the page.
+ */
+void sim_mem::demote(int pageType, int pageNumber)
+{
+    page_descriptor &page = page_table[pageType][pageNumber];
+    int size = segment_page_size[pageType];
+    int count = frames_per_page[pageType];
+    int slow_frame = findFreeRun(slow_frames, num_of_slow_pages, count);
+    if (slow_frame == -1)
+    {
+        slow_frame = oldestRun(1, count);
+        evictRun(1, slow_frame, count);
+    }
+
+    int from = page.frame * page_size;
+    int to = slow_frame * page_size;
+    for (int i = 0; i < size; i++)
+    {
+        slow_memory[to + i] = main_memory[from + i];
+        main_memory[from + i] = '0';
+    }
+    setRun(frames, page.frame, count, false);
+    setRun(slow_frames, slow_frame, count, true);
+    page.frame = slow_frame;
+    page.tier = 1;
+    page.accesses = 0;
+    demotions++;
+    if (profiler != NULL)
+        profiler->record_demote(pageType, pageNumber, timeT);
+    access_time += fast_latency + slow_latency;
+}
+
+/**
+ * Function to move a page from the slow tier to the main memory, demoting
+ * the oldest main memory pages if there is no room for it.
+ *
+ * @param pageType      The type of the page.
+ * @param pageNumber    The number of the page.
+ */
+void sim_mem::promote(int pageType, int pageNumber)
+{
+    page_descriptor &page = page_table[pageType][pageNumber];
+    int size = segment_page_size[pageType];
+    int count = frames_per_page[pageType];
+    char temp[size];
+    int from = page.frame * page_size;
+    for (int i = 0; i < size; i++)
+    {
+        temp[i] = slow_memory[from + i];
+        slow_memory[from + i] = '0';
+    }
+    setRun(slow_frames, page.frame, count, false);
+    // Take the page out of both tiers, so making room cannot pick it
+    page.valid = false;
+    makeRoom(pageType);
+
+    int frame_index = findFreeFrame(pageType);
+    for (int i = 0; i < size; i++)
+    {
+        main_memory[frame_index + i] = temp[i];
+    }
+    page.valid = true;
+    page.frame = frame_index / page_size;
+    page.tier = 0;
+    page.accesses = 0;
+    setRun(frames, page.frame, count, true);
+    promotions++;
+    if (profiler != NULL)
+        profiler->record_promote(pageType, pageNumber, timeT);
+    access_time += fast_latency + slow_latency;
+}
+
+/**
+ * Function to promote the slow tier pages that were hot in the last interval.
+ */
+void sim_mem::promoteHotPages()
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        int size = pagesOfType(i);
         for (int j = 0; j < size; ++j)
         {
-            if ((page_table[i][j].time < t) && (t > -1))
+            if (page_table[i][j].valid && page_table[i][j].tier == 1 &&
+                page_table[i][j].accesses >= promote_threshold)
             {
-                idx[0] = i;
-                idx[1] = j;
-                t = page_table[i][j].time;
+                promote(i, j);
             }
         }
     }
-    return idx;
+    // Start counting again, so only pages hot in the next interval move up
+    for (int i = 0; i < 4; ++i)
+    {
+        int size = pagesOfType(i);
+        for (int j = 0; j < size; ++j)
+        {
+            page_table[i][j].accesses = 0;
+        }
+    }
+}
+
+/**
+ * Function to count an access to a page that was in memory.
+ *
+ * @param pageType      The type of the page.
+ * @param pageNumber    The number of the page.
+ */
+void sim_mem::tierHit(int pageType, int pageNumber)
+{
+    if (page_table[pageType][pageNumber].tier == 1)
+    {
+        slow_hits++;
+        access_time += slow_latency;
+        page_table[pageType][pageNumber].accesses++;
+    }
+    else
+    {
+        fast_hits++;
+        access_time += fast_latency;
+    }
+    promoterTick();
+}
+
+/**
+ * Function to count an access that faulted. The page ends up in the main
+ * memory, so the access costs a fault plus a main memory access.
+ */
+void sim_mem::tierMiss()
+{
+    misses++;
+    access_time += swap_latency + fast_latency;
+    promoterTick();
+}
+
+/**
+ * Function to run a promotion scan every promote_interval accesses.
+ */
+void sim_mem::promoterTick()
+{
+    if (slow_memory == NULL)
+        return;
+    if (++accesses_since_scan >= promote_interval)
+    {
+        accesses_since_scan = 0;
+        promoteHotPages();
+    }
 }
 
 /**
@@ -586,11 +1014,10 @@ int *sim_mem::oldestPage()
  */
 void sim_mem::clearSwapFrame(int pageType, int pageNumber, int swap)
 {
-    char temp[page_size];
-    char zeros[page_size];
-    memset(zeros, '0', page_size);
+    int size = segment_page_size[pageType];
+    char temp[size];
 
-    int frame = findFreeFrame();
+    int frame = findFreeFrame(pageType);
     if (frame == -1)
     {
         printf("Error: No free frame found in main memory.\n");
@@ -601,31 +1028,52 @@ void sim_mem::clearSwapFrame(int pageType, int pageNumber, int swap)
     {
         // Read text page from the executable file
         int type = pageType;
-        int idx = type + pageNumber * page_size;
+        int idx = type + pageNumber * size;
         lseek(program_fd, idx, SEEK_SET);
-        read(program_fd, temp, page_size);
+        read(program_fd, temp, size);
     }
     else
     {
         // Read from swap
         int swap_index = swap;
         lseek(swapfile_fd, swap_index * page_size, SEEK_SET);
-        read(swapfile_fd, temp, page_size);
+        read(swapfile_fd, temp, size);
 
         // Clear the swap space
-        lseek(swapfile_fd, swap_index, SEEK_SET);
-        write(swapfile_fd, zeros, page_size);
+        releaseSwapSlot(swap_index, frames_per_page[pageType]);
     }
 
-    for (int i = 0; i < page_size; i++)
+    for (int i = 0; i < size; i++)
     {
         main_memory[frame + i] = temp[i];
     }
 
     page_table[pageType][pageNumber].valid = true;
     page_table[pageType][pageNumber].frame = frame / page_size;
+    page_table[pageType][pageNumber].tier = 0;
+    page_table[pageType][pageNumber].accesses = 0;
     page_table[pageType][pageNumber].swap_index = -1;
-    frames[frame / page_size] = true;
+    setRun(frames, frame / page_size, frames_per_page[pageType], true);
+}
+
+/**
+ * Function to mark swap slots as free and give their disk blocks back.
+ *
+ * @param swap  The swap index of the first slot.
+ * @param count The number of slots.
+ */
+void sim_mem::releaseSwapSlot(int swap, int count)
+{
+    setRun(swap_slots, swap, count, false);
+    // Punch a hole instead of writing zeros, the slots are tracked as free in
+    // swap_slots so their contents never need to be read again, and nothing
+    // is lost where hole punching is not supported
+    if (fallocate(swapfile_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  (off_t)swap * page_size, (off_t)count * page_size) == -1 &&
+        errno != EOPNOTSUPP && errno != ENOSYS)
+    {
+        perror("ERR");
+    }
 }
 
 /**
@@ -1,7 +1,10 @@
 #ifndef EX4_SIM_MEM_H
 #define EX4_SIM_MEM_H
+#ifndef MEMORY_SIZE
 #define MEMORY_SIZE 200
+#endif
 extern char main_memory[MEMORY_SIZE];
+class access_profiler;
 typedef struct page_descriptor
 {
     bool valid;
@@ -9,6 +12,8 @@ typedef struct page_descriptor
     bool dirty;
     int swap_index;
     int time;
+    int tier;     // 0 for the main memory, 1 for the slow tier
+    int accesses; // slow tier accesses since the last promotion scan
 } page_descriptor;
 
 class sim_mem
@@ -20,38 +25,97 @@ class sim_mem
     int bss_size;                 // size of the bss part
     int heap_stack_size;          // size of the heap stack part
     int num_of_pages;             // the total number of pages
-    int page_size;                // size of each page
+    int page_size;                // size of a frame, the smallest page size of all segments
+    int segment_page_size[4];     // page size of each segment
+    int frames_per_page[4];       // number of contiguous frames a page of each segment takes
     int num_of_txt_pages;         // the number of text pages
     int num_of_data_pages;        // the number of data pages
     int num_of_bss_pages;         // the number of bss pages
     int num_of_stack_heap_pages;  // the number of heap stack pages
+    int num_of_swap_pages;        // the number of page slots in the swap file
     page_descriptor **page_table; // pointer to page table
     bool *frames;
+    bool *swap_slots;             // which swap slots are in use
+    int swap_region[4];           // first swap slot of each segment's region
+    access_profiler *profiler;    // optional access profiler, NULL when disabled
+    char *slow_memory;            // slow tier memory, NULL when there is no slow tier
+    bool *slow_frames;            // which slow tier frames are in use
+    int num_of_slow_pages;        // the number of frames in the slow tier
+    int fast_latency;             // cost of an access served by the main memory
+    int slow_latency;             // cost of an access served by the slow tier
+    int swap_latency;             // extra cost of an access that faults
+    int promote_threshold;        // slow tier accesses in an interval that make a page hot
+    int promote_interval;         // number of accesses between promotion scans
+    int accesses_since_scan;      // accesses since the last promotion scan
+    long fast_hits;               // accesses served by the main memory
+    long slow_hits;               // accesses served by the slow tier
+    long misses;                  // accesses that faulted
+    long promotions;              // pages moved from the slow tier to the main memory
+    long demotions;               // pages moved from the main memory to the slow tier
+    long long access_time;        // simulated time of all accesses and page moves
 
 private:
-    void decimalToBinary(int decimal, int ad[]);
+    void init(char exe_file_name[], char swap_file_name[], int text_size,
+              int data_size, int bss_size, int heap_stack_size,
+              int page_sizes[]);
 
-    void copyAr(int source[], int dest[], int start, int end);
+    void writeToMainMemory(int pageType, int pageNumber);
 
-    int binaryToDecimal(int binary[], int size);
+    void decodeAddress(int address, int &memT, int &pageN, int &offs);
 
-    void writeToMainMemory(int pageType, int pageNumber);
+    int findFreeRun(bool *map, int size, int count);
+
+    void setRun(bool *map, int first, int count, bool used);
 
-    int findFreeFrame();
+    int findFreeFrame(int pageType);
+
+    void makeRoom(int pageType);
 
     void writeToSwapFile(int pageType, int pageNumber, int f);
 
-    int getNextFreeSwapFrame();
+    int getNextFreeSwapFrame(int pageType);
 
     void clearSwapFrame(int pageType, int pageNumber, int swap);
 
-    int *oldestPage();
+    void releaseSwapSlot(int swap, int count);
+
+    bool pageInRun(int tier, int pageType, int pageNumber, int first, int count);
+
+    int oldestRun(int tier, int count);
+
+    void evictRun(int tier, int first, int count);
+
+    int pagesOfType(int pageType);
+
+    char *tierMemory(int tier);
+
+    bool *tierFrames(int tier);
+
+    void demote(int pageType, int pageNumber);
+
+    void promote(int pageType, int pageNumber);
+
+    void promoteHotPages();
+
+    void tierHit(int pageType, int pageNumber);
+
+    void tierMiss();
+
+    void promoterTick();
+
+    void printPageTableHeader();
+
+    void printPageDescriptor(page_descriptor &page);
 
 public:
     sim_mem(char exe_file_name[], char swap_file_name[], int text_size,
             int data_size, int bss_size, int heap_stack_size,
             int page_size);
 
+    sim_mem(char exe_file_name[], char swap_file_name[], int text_size,
+            int data_size, int bss_size, int heap_stack_size,
+            int page_sizes[]);
+
     ~sim_mem();
 
     char load(int address);
@@ -64,6 +128,13 @@ public:
 
     void print_page_table();
 
+    void set_profiler(access_profiler *profiler);
+
+    void set_slow_tier(int slow_memory_size, int fast_latency, int slow_latency,
+                       int swap_latency, int promote_threshold, int promote_interval);
+
+    void print_tier_stats();
+
 #endif // EX4_SIM_MEM_H
 
     bool legalAddres(int address, int memoryType);